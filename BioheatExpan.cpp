@@ -25,9 +25,13 @@ SOFTWARE.
 #include <vector>
 #include <chrono>
 #include <fstream>
+#include <cfloat>
 #include <omp.h>
+#include "SharedFrames.h"
 using namespace    std;
 static const int   NUM_THREADS(omp_get_max_threads());
+static const int   CG_MAX_ITERS(1000);  // implicit thermal solver: max PCG iterations per thermal step
+static const float CG_TOL(1e-6f);       // implicit thermal solver: relative residual tolerance
 
 // matrix computation/operations (mat: matrix, 33: 3 rows by 3 columns, x: multiplication, T: transpose, Det: determinant, Inv: inverse)
 void mat33x33    (const float A[3][3], const float B[3][3], float AB[3][3]);
@@ -45,8 +49,11 @@ void matInv33    (const float A[3][3], float invA[3][3], float &detA);
 // classes
 class Node;
 class T4;
+class TetGrid;
+class HeatSource;
 class Model;
 class ModelStates;
+class ShmPublisher;
 
 // methods
 Model*       readModel       (int argc, char **argv);
@@ -54,8 +61,15 @@ void         printInfo       (const Model& model);
 ModelStates* runSimulation   (const Model& model);
 void         initBC          (const Model& model, ModelStates& modelstates);
 void         computeRunTimeBC(const Model& model, ModelStates& modelstates, const size_t curr_step);
-bool         computeOneStep  (const Model& model, ModelStates& modelstates);
+void         moveHeatSource  (ModelStates& modelstates, const size_t source_idx, const float p0[3], const float p1[3]);
+void         computeHeatSources(const Model& model, ModelStates& modelstates);
+bool         computeOneStep  (const Model& model, ModelStates& modelstates, const bool update_K);
+bool         computeImplicitT(const Model& model, ModelStates& modelstates, const float T_dt);
+void         computeThermalOperator(const Model& model, ModelStates& modelstates, const vector<float>& x, const float a_inv_dt, const float b, vector<float>& y);
+double       dotProduct      (const vector<float>& x, const vector<float>& y);
+void         recordProbes    (const Model& model, ModelStates& modelstates, const size_t curr_step);
 int          exportVTK       (const Model& model, const ModelStates& modelstates);
+int          exportProbes    (const Model& model, const ModelStates& modelstates);
 
 class Node
 {
@@ -120,11 +134,117 @@ public:
     };
 };
 
+class TetGrid // uniform grid over tet bounding boxes, for point location and region queries
+{
+public:
+    float                m_min[3], m_h;
+    unsigned int         m_dims[3];
+    vector<unsigned int> m_cell_begin, m_cell_tets; // tets overlapping cell c: m_cell_tets[m_cell_begin[c]] to m_cell_tets[m_cell_begin[c + 1] - 1]
+    vector<float>        m_tet_box;                 // per tet: min x y z, max x y z
+    TetGrid() :
+        m_min{ 0.f, 0.f, 0.f }, m_h(1.f), m_dims{ 0, 0, 0 }, m_cell_begin(0), m_cell_tets(0), m_tet_box(0) {};
+    void build(const vector<Node*>& nodes, const vector<T4*>& tets)
+    {
+        float max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        m_min[0] = FLT_MAX; m_min[1] = FLT_MAX; m_min[2] = FLT_MAX;
+        m_tet_box.resize(tets.size() * 6);
+        for (T4* tet : tets)
+        {
+            float* box = &m_tet_box[tet->m_idx * 6];
+            for (size_t n = 0; n < 3; n++) { box[n] = FLT_MAX; box[n + 3] = -FLT_MAX; }
+            for (size_t m = 0; m < 4; m++)
+            {
+                const float X[3] = { nodes[tet->m_n_idx[m]]->m_x, nodes[tet->m_n_idx[m]]->m_y, nodes[tet->m_n_idx[m]]->m_z };
+                for (size_t n = 0; n < 3; n++) { if (X[n] < box[n]) { box[n] = X[n]; } if (X[n] > box[n + 3]) { box[n + 3] = X[n]; } }
+            }
+            for (size_t n = 0; n < 3; n++) { if (box[n] < m_min[n]) { m_min[n] = box[n]; } if (box[n + 3] > max[n]) { max[n] = box[n + 3]; } }
+        }
+        m_h = 1.5f * cbrt((max[0] - m_min[0]) * (max[1] - m_min[1]) * (max[2] - m_min[2]) / tets.size()); // a few tets per cell
+        if (!(m_h > 0.f)) { m_h = 1.f; }
+        for (size_t n = 0; n < 3; n++) { m_dims[n] = (unsigned int)((max[n] - m_min[n]) / m_h) + 1; }
+        // bin tets into all cells overlapped by their bounding boxes (count, prefix sum, fill)
+        m_cell_begin.assign((size_t)m_dims[0] * m_dims[1] * m_dims[2] + 1, 0);
+        unsigned int c0[3], c1[3];
+        for (T4* tet : tets)
+        {
+            getCellRange(&m_tet_box[tet->m_idx * 6], &m_tet_box[tet->m_idx * 6 + 3], c0, c1);
+            for (unsigned int k = c0[2]; k <= c1[2]; k++) { for (unsigned int j = c0[1]; j <= c1[1]; j++) { for (unsigned int i = c0[0]; i <= c1[0]; i++) { m_cell_begin[getCellIndex(i, j, k) + 1]++; } } }
+        }
+        for (size_t c = 1; c < m_cell_begin.size(); c++) { m_cell_begin[c] += m_cell_begin[c - 1]; }
+        m_cell_tets.resize(m_cell_begin.back());
+        vector<unsigned int> tracking(m_cell_begin.cbegin(), m_cell_begin.cend() - 1);
+        for (T4* tet : tets)
+        {
+            getCellRange(&m_tet_box[tet->m_idx * 6], &m_tet_box[tet->m_idx * 6 + 3], c0, c1);
+            for (unsigned int k = c0[2]; k <= c1[2]; k++) { for (unsigned int j = c0[1]; j <= c1[1]; j++) { for (unsigned int i = c0[0]; i <= c1[0]; i++) { m_cell_tets[tracking[getCellIndex(i, j, k)]++] = tet->m_idx; } } }
+        }
+    }
+    size_t getCellIndex(const unsigned int i, const unsigned int j, const unsigned int k) const { return ((size_t)k * m_dims[1] + j) * m_dims[0] + i; }
+    unsigned int getCell(const float x, const size_t n) const // cell coordinate along axis n, clamped to the grid
+    {
+        const float c((x - m_min[n]) / m_h);
+        return c <= 0.f ? 0 : (c >= m_dims[n] - 1 ? m_dims[n] - 1 : (unsigned int)c);
+    }
+    void getCellRange(const float lo[3], const float hi[3], unsigned int c0[3], unsigned int c1[3]) const
+    {
+        for (size_t n = 0; n < 3; n++) { c0[n] = getCell(lo[n], n); c1[n] = getCell(hi[n], n); }
+    }
+    bool isInside(const float X[3]) const
+    {
+        for (size_t n = 0; n < 3; n++) { if (X[n] < m_min[n] || X[n] > m_min[n] + m_dims[n] * m_h) { return false; } }
+        return true;
+    }
+    void query(const float lo[3], const float hi[3], vector<unsigned int>& tets) const // appends tets whose bounding boxes overlap [lo, hi], each once
+    {
+        for (size_t n = 0; n < 3; n++) { if (hi[n] < m_min[n] || lo[n] > m_min[n] + m_dims[n] * m_h) { return; } }
+        unsigned int c0[3], c1[3];
+        getCellRange(lo, hi, c0, c1);
+        for (unsigned int k = c0[2]; k <= c1[2]; k++) { for (unsigned int j = c0[1]; j <= c1[1]; j++) { for (unsigned int i = c0[0]; i <= c1[0]; i++)
+        {
+            const size_t c(getCellIndex(i, j, k));
+            for (unsigned int t = m_cell_begin[c]; t < m_cell_begin[c + 1]; t++)
+            {
+                const float* box = &m_tet_box[m_cell_tets[t] * 6];
+                if (box[0] > hi[0] || box[1] > hi[1] || box[2] > hi[2] || box[3] < lo[0] || box[4] < lo[1] || box[5] < lo[2]) { continue; }
+                // report a tet only from the first queried cell it overlaps, to avoid duplicates
+                const unsigned int first[3] = { getCell(box[0], 0), getCell(box[1], 1), getCell(box[2], 2) };
+                if ((first[0] > c0[0] ? first[0] : c0[0]) == i && (first[1] > c0[1] ? first[1] : c0[1]) == j && (first[2] > c0[2] ? first[2] : c0[2]) == k) { tets.push_back(m_cell_tets[t]); }
+            }
+        } } }
+    }
+};
+
+class HeatSource // geometric heat source of radius r: Point (sphere), Segment (capsule) or Cylinder (flat ends), power P distributed with the radial profile 1-(d/r)^2
+{
+public:
+    const string m_type;
+    const float  m_power, m_radius, m_v[3]; // v: velocity of a moving source
+    float        m_p0[3], m_p1[3];          // current position, p1 = p0 for Point
+    HeatSource(const string type, const float power, const float radius, const float p0[3], const float p1[3], const float v[3]) :
+        m_type(type), m_power(power), m_radius(radius), m_v{ v[0], v[1], v[2] }, m_p0{ p0[0], p0[1], p0[2] }, m_p1{ p1[0], p1[1], p1[2] } {};
+    void getBounds(float lo[3], float hi[3]) const
+    {
+        for (size_t n = 0; n < 3; n++) { lo[n] = (m_p0[n] < m_p1[n] ? m_p0[n] : m_p1[n]) - m_radius; hi[n] = (m_p0[n] > m_p1[n] ? m_p0[n] : m_p1[n]) + m_radius; }
+    }
+    float computeDistance(const float X[3]) const // distance to the source axis, FLT_MAX beyond the flat ends of a Cylinder
+    {
+        const float ab[3] = { m_p1[0] - m_p0[0], m_p1[1] - m_p0[1], m_p1[2] - m_p0[2] }, ap[3] = { X[0] - m_p0[0], X[1] - m_p0[1], X[2] - m_p0[2] },
+                    len_sq(ab[0] * ab[0] + ab[1] * ab[1] + ab[2] * ab[2]);
+        float s(len_sq > 0.f ? (ap[0] * ab[0] + ap[1] * ab[1] + ap[2] * ab[2]) / len_sq : 0.f);
+        if (m_type == "Cylinder" && (s < 0.f || s > 1.f)) { return FLT_MAX; }
+        s = s < 0.f ? 0.f : (s > 1.f ? 1.f : s);
+        const float d[3] = { ap[0] - s * ab[0], ap[1] - s * ab[1], ap[2] - s * ab[2] };
+        return sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    }
+};
+
 class Model
 {
 public:
     vector<Node*>        m_nodes;
     vector<T4*>          m_tets;
+    TetGrid              m_grid;
+    vector<HeatSource>   m_heat_sources;
     size_t               m_num_BCs,    m_num_steps,  m_num_M_DOFs, m_num_T_DOFs;
     vector<unsigned int> m_disp_idx_x, m_disp_idx_y, m_disp_idx_z,
                          m_fixP_idx_x, m_fixP_idx_y, m_fixP_idx_z,
@@ -136,15 +256,25 @@ public:
                          m_fixT_mag,
                          m_bhflux_mag,
                          m_metabo_mag,
-                         m_M_material_vals, m_T_material_vals, m_T_expan_vals;
-    float                m_dt, m_total_t, m_alpha, m_T0, m_rho;
+                         m_M_material_vals, m_T_material_vals, m_T_expan_vals,
+                         m_probe_X,    m_probe_N;               // probes: coordinates (x,y,z per probe), barycentric weights in the containing tet (4 per probe)
+    vector<unsigned int> m_probe_ele_idx;                       // probes: containing tet
+    float                m_dt, m_total_t, m_alpha, m_T0, m_rho,
+                         m_T_dt, m_T_theta;                     // implicit thermal solver: thermal time step (multiple of m_dt), theta (1: backward Euler, 0.5: Crank-Nicolson)
+    bool                 m_implicit_T;
     const string         m_fname;
-    string               m_ele_type, m_M_material_type, m_T_material_type, m_T_expan_type;
-    unsigned int         m_node_begin_index, m_ele_begin_index,
+    string               m_ele_type, m_M_material_type, m_T_material_type, m_T_expan_type,
+                         m_shm_name,                            // shared-memory live frames (disabled if m_shm_every == 0)
+                         m_probe_format;                        // probes: CSV or Binary
+    unsigned int         m_shm_every,  m_shm_slots,
+                         m_T_dt_ratio,                          // mechanical steps per thermal step
+                         m_M_substeps,                          // mechanical steps computed per thermal step (< m_T_dt_ratio: quasi-static mechanics)
+                         m_probe_stride,                        // probes: steps between records
+                         m_node_begin_index, m_ele_begin_index,
                         *m_ele_node_local_idx_pair,
                         *m_tracking_num_eles_i_eles_per_node_j;
     Model(const string fname) :
-        m_nodes     (0), m_tets      (0),
+        m_nodes     (0), m_tets      (0), m_grid(), m_heat_sources(),
         m_num_BCs   (0), m_num_steps (0), m_num_M_DOFs  (0), m_num_T_DOFs(0),
         m_disp_idx_x(0), m_disp_idx_y(0), m_disp_idx_z  (0),
         m_fixP_idx_x(0), m_fixP_idx_y(0), m_fixP_idx_z  (0),
@@ -156,8 +286,12 @@ public:
         m_bhflux_idx(0), m_bhflux_mag(0),
         m_metabo_mag(0),
         m_M_material_vals(0), m_T_material_vals(0), m_T_expan_vals(0),
+        m_probe_X(0), m_probe_N(0), m_probe_ele_idx(0),
         m_dt(0.f), m_total_t(0.f), m_alpha(0.f), m_T0(0.f), m_rho(0.f),
+        m_T_dt(0.f), m_T_theta(1.f), m_implicit_T(false),
         m_fname(fname), m_ele_type(""), m_M_material_type(""), m_T_material_type(""), m_T_expan_type(""),
+        m_shm_name(""), m_probe_format("CSV"), m_shm_every(0), m_shm_slots(0),
+        m_T_dt_ratio(1), m_M_substeps(1), m_probe_stride(1),
         m_node_begin_index(0), m_ele_begin_index(0),
         m_ele_node_local_idx_pair(nullptr), m_tracking_num_eles_i_eles_per_node_j(nullptr) {};
     ~Model()
@@ -167,7 +301,7 @@ public:
         delete[] m_ele_node_local_idx_pair;
         delete[] m_tracking_num_eles_i_eles_per_node_j;
     };
-    void postCreate()
+    bool postCreate()
     {
         // below: provide indexing for nodal states (e.g., individual ele nodal internal forces and thermal loads) to avoid race condition in parallel computing
         m_tracking_num_eles_i_eles_per_node_j = new unsigned int[m_nodes.size() * 2]; memset(m_tracking_num_eles_i_eles_per_node_j, 0, sizeof(unsigned int) * m_nodes.size() * 2);
@@ -192,6 +326,65 @@ public:
                 *p_ele_node_local_idx_pair = nodes_ele_node_local_idx_pair[m][n * 2 + 1]; p_ele_node_local_idx_pair++; // m
             }
         }
+        m_grid.build(m_nodes, m_tets);
+        return locateProbes();
+    }
+    void computeN(const T4& tet, const float X[3], float N[4]) const // barycentric coordinates (linear shape functions) of point X in tet
+    {
+        const Node* n1 = m_nodes[tet.m_n_idx[0]];
+        const float dX[3] = { X[0] - n1->m_x, X[1] - n1->m_y, X[2] - n1->m_z };
+        for (size_t m = 0; m < 4; m++) { N[m] = (m == 0 ? 1.f : 0.f) + tet.m_DHDX[0][m] * dX[0] + tet.m_DHDX[1][m] * dX[1] + tet.m_DHDX[2][m] * dX[2]; }
+    }
+    int locateTet(const float X[3], float N[4]) const // containing tet of point X and its barycentric coordinates, -1 if outside the mesh
+    {
+        if (!m_grid.isInside(X)) { return -1; }
+        const size_t c(m_grid.getCellIndex(m_grid.getCell(X[0], 0), m_grid.getCell(X[1], 1), m_grid.getCell(X[2], 2)));
+        for (unsigned int t = m_grid.m_cell_begin[c]; t < m_grid.m_cell_begin[c + 1]; t++)
+        {
+            computeN(*m_tets[m_grid.m_cell_tets[t]], X, N);
+            if (N[0] >= -1e-5f && N[1] >= -1e-5f && N[2] >= -1e-5f && N[3] >= -1e-5f) { return (int)m_grid.m_cell_tets[t]; }
+        }
+        return -1;
+    }
+    bool locateProbes() // find the containing tet of each probe once, points just outside the mesh (within half the tet's longest edge) are snapped to the nearest tet, false if farther
+    {
+        const size_t num_probes(m_probe_X.size() / 3);
+        m_probe_ele_idx.assign(num_probes, 0); m_probe_N.assign(num_probes * 4, 0.f);
+        for (size_t i = 0; i < num_probes; i++)
+        {
+            float N[4], best_min_N(-FLT_MAX);
+            const int ele_idx(locateTet(&m_probe_X[i * 3], N));
+            if (ele_idx >= 0) { m_probe_ele_idx[i] = ele_idx; memcpy(&m_probe_N[i * 4], N, sizeof(float) * 4); continue; }
+            for (T4* tet : m_tets)
+            {
+                computeN(*tet, &m_probe_X[i * 3], N);
+                float min_N(N[0]); for (size_t m = 1; m < 4; m++) { if (N[m] < min_N) { min_N = N[m]; } }
+                if (min_N > best_min_N) { best_min_N = min_N; m_probe_ele_idx[i] = tet->m_idx; memcpy(&m_probe_N[i * 4], N, sizeof(float) * 4); }
+            }
+            if (best_min_N < -1e-3f)
+            {
+                float sum_N(0.f); for (size_t m = 0; m < 4; m++) { m_probe_N[i * 4 + m] = m_probe_N[i * 4 + m] > 0.f ? m_probe_N[i * 4 + m] : 0.f; sum_N += m_probe_N[i * 4 + m]; }
+                for (size_t m = 0; m < 4; m++) { m_probe_N[i * 4 + m] /= sum_N; }
+                const T4* tet = m_tets[m_probe_ele_idx[i]];
+                float X_snap[3] = { 0.f, 0.f, 0.f }, max_edge(0.f);
+                for (size_t m = 0; m < 4; m++)
+                {
+                    const Node* n1 = m_nodes[tet->m_n_idx[m]];
+                    X_snap[0] += m_probe_N[i * 4 + m] * n1->m_x; X_snap[1] += m_probe_N[i * 4 + m] * n1->m_y; X_snap[2] += m_probe_N[i * 4 + m] * n1->m_z;
+                    for (size_t n = m + 1; n < 4; n++)
+                    {
+                        const Node* n2 = m_nodes[tet->m_n_idx[n]];
+                        const float edge(sqrt((n2->m_x - n1->m_x) * (n2->m_x - n1->m_x) + (n2->m_y - n1->m_y) * (n2->m_y - n1->m_y) + (n2->m_z - n1->m_z) * (n2->m_z - n1->m_z)));
+                        if (edge > max_edge) { max_edge = edge; }
+                    }
+                }
+                const float* X = &m_probe_X[i * 3];
+                const float dist(sqrt((X[0] - X_snap[0]) * (X[0] - X_snap[0]) + (X[1] - X_snap[1]) * (X[1] - X_snap[1]) + (X[2] - X_snap[2]) * (X[2] - X_snap[2])));
+                if (dist > 0.5f * max_edge) { cerr << "\n\tError: probe " << i << " (" << X[0] << " " << X[1] << " " << X[2] << ") is outside the mesh, " << dist << " from the nearest ele " << tet->m_idx + m_ele_begin_index << "." << endl; return false; }
+                cerr << "\n\tWarning: probe " << i << " (" << X[0] << " " << X[1] << " " << X[2] << ") is just outside the mesh (" << dist << "), snapped to ele " << tet->m_idx + m_ele_begin_index << "." << endl;
+            }
+        }
+        return true;
     }
 };
 
@@ -205,8 +398,16 @@ public:
                   m_external_Q,          m_external_Q0,         m_ele_nodal_internal_Q, // individual ele nodal internal Q to avoid race condition, can be summed to get internal_Q for nodes
                   m_fixT_mag,
                   m_constA,
-                  m_curr_T,              m_next_T;
-    vector<bool>  m_fixP_flag,           m_fixT_flag;
+                  m_curr_T,              m_next_T,
+                  m_T_capacity,          m_perfu_coef,          m_perfu_coefT,          // implicit thermal solver: nodal thermal mass*c, perfusion wb*Vol*cb and wb*Vol*cb*refT
+                  m_cg_b, m_cg_r, m_cg_z, m_cg_p, m_cg_Ap, m_cg_diag,                   // implicit thermal solver: PCG work vectors, Jacobi preconditioner
+                  m_probe_hist,                                                         // probes: per record t, then T, Ux, Uy, Uz per probe
+                  m_source_Q,            m_source_weights;                              // heat sources: nodal heat, per candidate tet weight
+    vector<unsigned int> m_source_nodes, m_source_prev_nodes, m_source_tets;            // heat sources: nodes receiving source heat (now, before the last move), candidate tets
+    vector<HeatSource>   m_heat_sources;                                                // heat sources: current positions
+    bool          m_heat_sources_moved;
+    vector<bool>  m_fixP_flag,           m_fixT_flag,           m_source_flag,          // m_source_flag: node is in m_source_nodes
+                  m_source_outside,      m_source_tracked;                              // per heat source: maps to no tet (warned once), moved by moveHeatSource (its velocity no longer applies)
     ModelStates(const Model& model) :
         m_external_F         (model.m_num_M_DOFs,        0.f), m_ele_nodal_internal_F(model.m_tets.size() * 4 * 3, 0.f),
         m_disp_mag_t         (model.m_num_M_DOFs,        0.f),
@@ -216,8 +417,16 @@ public:
         m_fixT_mag           (model.m_num_T_DOFs,        0.f),
         m_constA             (model.m_num_T_DOFs,        0.f),
         m_curr_T             (model.m_num_T_DOFs, model.m_T0), m_next_T              (model.m_num_T_DOFs,   model.m_T0),
-        m_fixP_flag          (model.m_num_M_DOFs,      false), m_fixT_flag           (model.m_num_T_DOFs,        false)
+        m_T_capacity(model.m_implicit_T ? model.m_num_T_DOFs : 0, 0.f), m_perfu_coef(model.m_implicit_T ? model.m_num_T_DOFs : 0, 0.f), m_perfu_coefT(model.m_implicit_T ? model.m_num_T_DOFs : 0, 0.f),
+        m_cg_b(model.m_implicit_T ? model.m_num_T_DOFs : 0, 0.f), m_cg_r (model.m_implicit_T ? model.m_num_T_DOFs : 0, 0.f), m_cg_z   (model.m_implicit_T ? model.m_num_T_DOFs : 0, 0.f),
+        m_cg_p(model.m_implicit_T ? model.m_num_T_DOFs : 0, 0.f), m_cg_Ap(model.m_implicit_T ? model.m_num_T_DOFs : 0, 0.f), m_cg_diag(model.m_implicit_T ? model.m_num_T_DOFs : 0, 0.f),
+        m_probe_hist(0),
+        m_source_Q           (model.m_num_T_DOFs,        0.f), m_source_weights(0), m_source_nodes(0), m_source_prev_nodes(0), m_source_tets(0),
+        m_heat_sources(model.m_heat_sources.cbegin(), model.m_heat_sources.cend()), m_heat_sources_moved(true),
+        m_fixP_flag          (model.m_num_M_DOFs,      false), m_fixT_flag           (model.m_num_T_DOFs,        false), m_source_flag(model.m_num_T_DOFs, false),
+        m_source_outside     (model.m_heat_sources.size(), false), m_source_tracked(model.m_heat_sources.size(), false)
     {
+        if (!model.m_probe_ele_idx.empty()) { m_probe_hist.reserve(model.m_num_steps / model.m_probe_stride * (1 + model.m_probe_ele_idx.size() * 4)); } // 4 * (1 + 4 * num_probes) bytes per record
         vector<float> nodal_M_mass(model.m_num_M_DOFs, 0.f);
         for (T4* tet : model.m_tets) { for (size_t m = 0; m < 4; m++) { for (size_t n = 0; n < 3; n++) { nodal_M_mass[tet->m_n_idx[m] * 3 + n] += tet->m_mass / 4.f; } } }
         for (size_t i = 0; i < model.m_num_M_DOFs; i++)
@@ -229,6 +438,54 @@ public:
         vector<float> nodal_T_mass(model.m_num_T_DOFs, 0.f);
         for (T4* tet : model.m_tets) { for (size_t m = 0; m < 4; m++) { nodal_T_mass[tet->m_n_idx[m]] += tet->m_mass / 4.f; } }
         for (size_t i = 0; i < model.m_num_T_DOFs; i++) { m_constA[i] = model.m_dt / (nodal_T_mass[i] * model.m_T_material_vals[0]); }
+        for (size_t i = 0; i < m_T_capacity.size(); i++) { m_T_capacity[i] = nodal_T_mass[i] * model.m_T_material_vals[0]; }
+    };
+};
+
+class ShmPublisher // writes T/U frames into the shared-memory ring buffer (SharedFrames.h), never waits for readers
+{
+public:
+    ShmMapping m_mapping;
+    ShmHeader* m_header;
+    uint64_t   m_num_frames;
+    ShmPublisher(const Model& model) :
+        m_mapping(), m_header(nullptr), m_num_frames(0)
+    {
+        const uint32_t num_nodes((uint32_t)model.m_nodes.size());
+        if (!shmCreate(model.m_shm_name, shmHeaderBytes() + model.m_shm_slots * shmSlotBytes(num_nodes), m_mapping)) { return; }
+        m_header = new (m_mapping.m_ptr) ShmHeader();
+        m_header->m_version      = SHM_VERSION;
+        m_header->m_num_nodes    = num_nodes;
+        m_header->m_num_slots    = model.m_shm_slots;
+        m_header->m_every        = model.m_shm_every;
+        m_header->m_dt           = model.m_dt;
+        m_header->m_header_bytes = shmHeaderBytes();
+        m_header->m_slot_bytes   = shmSlotBytes(num_nodes);
+        m_header->m_writer_pid   = shmProcessId();
+        m_header->m_session_id   = ((uint64_t)m_header->m_writer_pid << 32) ^ (uint64_t)shmNowNs();
+        m_header->m_heartbeat_ns.store(shmNowNs(), memory_order_relaxed);
+        for (uint64_t k = 0; k < model.m_shm_slots; k++) { new (shmSlot(m_header, k)) ShmSlotHeader(); }
+        atomic_thread_fence(memory_order_release);
+        m_header->m_magic = SHM_MAGIC; // readers attach only once the magic is set
+    };
+    ~ShmPublisher()
+    {
+        if (m_header != nullptr) { m_header->m_done.store(1, memory_order_release); }
+        shmRelease(m_mapping);
+    };
+    void heartbeat() { m_header->m_heartbeat_ns.store(shmNowNs(), memory_order_release); }; // called every step, lets readers tell a running solver from a dead one
+    void publish(const ModelStates& modelstates, const size_t step, const float t)
+    {
+        ShmSlotHeader* slot = shmSlot(m_header, m_num_frames);
+        slot->m_seq.store(m_num_frames * 2 + 1, memory_order_relaxed); // odd: slot is being written
+        atomic_thread_fence(memory_order_release);
+        memcpy(shmSlotT(slot),                        modelstates.m_curr_T.data(), sizeof(float) * m_header->m_num_nodes);
+        memcpy(shmSlotU(slot, m_header->m_num_nodes), modelstates.m_curr_U.data(), sizeof(float) * m_header->m_num_nodes * 3);
+        slot->m_step       = step;
+        slot->m_t          = t;
+        slot->m_publish_ns = shmNowNs();
+        slot->m_seq.store(m_num_frames * 2 + 2, memory_order_release); // even: slot is complete
+        m_header->m_write_seq.store(++m_num_frames, memory_order_release);
     };
 };
 
@@ -242,6 +499,7 @@ int main(int argc, char **argv)
         if (modelstates != nullptr)
         {
             int exit = exportVTK(*model, *modelstates);
+            if (exit == EXIT_SUCCESS && !model->m_probe_ele_idx.empty()) { exit = exportProbes(*model, *modelstates); }
             delete model;
             delete modelstates;
             return exit;
@@ -376,6 +634,20 @@ Model* readModel(int argc, char **argv)
                 model->m_metabo_mag.resize(model->m_nodes.size(), 0.f); for (T4* tet : model->m_tets) { for (size_t m = 0; m < 4; m++) { model->m_metabo_mag[tet->m_n_idx[m]] += q * tet->m_Vol / 4.f; } }
                 model->m_num_BCs++;
             }
+            else if (BC_type == "<HeatSource>") // Geometric heat source: type (Point, Segment or Cylinder), power, radius, x y z (Point) or x0 y0 z0 x1 y1 z1, optional velocity vx vy vz
+            {
+                float P(0.f), r(0.f), p0[3] = { 0.f, 0.f, 0.f }, p1[3] = { 0.f, 0.f, 0.f }, v[3] = { 0.f, 0.f, 0.f };
+                fscanf_s(file, "%s %f %f", buffer, (unsigned int)sizeof(buffer), &P, &r); string source_type(buffer);
+                if (source_type != "Point" && source_type != "Segment" && source_type != "Cylinder") { cerr << "\n\tError: unknown HeatSource type: " << buffer << " (Point, Segment or Cylinder)." << endl; fclose(file); delete model; return nullptr; }
+                fscanf_s(file, "%f %f %f", &p0[0], &p0[1], &p0[2]);
+                if (source_type == "Point") { memcpy(p1, p0, sizeof(float) * 3); }
+                else                        { fscanf_s(file, "%f %f %f", &p1[0], &p1[1], &p1[2]); }
+                const int num_v(fscanf_s(file, "%f %f %f", &v[0], &v[1], &v[2])); // velocity is optional, but all 3 components are required if given
+                if (num_v == 1 || num_v == 2) { cerr << "\n\tError: HeatSource velocity requires 3 components (vx vy vz)." << endl; fclose(file); delete model; return nullptr; }
+                if (num_v != 3) { v[0] = 0.f; v[1] = 0.f; v[2] = 0.f; }
+                model->m_heat_sources.push_back(HeatSource(source_type, P, r, p0, p1, v));
+                model->m_num_BCs++;
+            }
             else if (BC_type == "other_BC_types") { /*add your code here*/ }
             else if (BC_type == "</BC>") { break; }
         }
@@ -383,11 +655,46 @@ Model* readModel(int argc, char **argv)
         fscanf_s(file, "%s %f", buffer, (unsigned int)sizeof(buffer), &model->m_T0);
         fscanf_s(file, "%s %f", buffer, (unsigned int)sizeof(buffer), &model->m_dt);
         fscanf_s(file, "%s %f", buffer, (unsigned int)sizeof(buffer), &model->m_total_t);
+        while (fscanf_s(file, "%s", buffer, (unsigned int)sizeof(buffer)) == 1) // optional settings
+        {
+            string option(buffer);
+            if (option == "SharedMemory") // live T/U frames: name, steps between frames, ring buffer slots
+            {
+                unsigned int every(0), slots(0); fscanf_s(file, "%s %u %u", buffer, (unsigned int)sizeof(buffer), &every, &slots); model->m_shm_name = buffer;
+                model->m_shm_every = every > 0 ? every : 1; model->m_shm_slots = slots > 2 ? slots : 2;
+            }
+            else if (option == "ThermalSolver") // Explicit (default), or Implicit theta thermal_time_step [mechanical_substeps]
+            {
+                fscanf_s(file, "%s", buffer, (unsigned int)sizeof(buffer)); string solver(buffer);
+                if (solver == "Implicit")
+                {
+                    model->m_implicit_T = true;
+                    if (fscanf_s(file, "%f %f", &model->m_T_theta, &model->m_T_dt) != 2 || model->m_T_theta < 0.5f || model->m_T_theta > 1.f || !(model->m_T_dt > 0.f))
+                    {
+                        cerr << "\n\tError: ThermalSolver Implicit requires 0.5 <= theta <= 1 and thermal time step > 0." << endl; fclose(file); delete model; return nullptr;
+                    }
+                    if (fscanf_s(file, "%u", &idx) == 1) { model->m_M_substeps = idx; } else { model->m_M_substeps = 0; } // 0: all mechanical steps (time-accurate mechanics)
+                }
+                else if (solver != "Explicit") { cerr << "\n\tError: unknown ThermalSolver: " << solver.c_str() << endl; fclose(file); delete model; return nullptr; }
+            }
+            else if (option == "Probe") // point probes: output format (CSV or Binary), steps between records, then x y z per probe
+            {
+                fscanf_s(file, "%s", buffer, (unsigned int)sizeof(buffer)); model->m_probe_format = buffer;
+                if (model->m_probe_format != "CSV" && model->m_probe_format != "Binary") { cerr << "\n\tError: unknown Probe format: " << buffer << " (CSV or Binary)." << endl; fclose(file); delete model; return nullptr; }
+                if (fscanf_s(file, "%u", &idx) != 1 || idx == 0) { cerr << "\n\tError: Probe requires steps between records >= 1." << endl; fclose(file); delete model; return nullptr; }
+                model->m_probe_stride = idx;
+                while (fscanf_s(file, "%f %f %f", &x, &y, &z) == 3) { model->m_probe_X.push_back(x); model->m_probe_X.push_back(y); model->m_probe_X.push_back(z); }
+            }
+            else if (option == "other_options") { /*add your code here*/ }
+        }
         fclose(file);
         model->m_num_steps = (size_t)ceil(model->m_total_t / model->m_dt);
+        if (model->m_implicit_T) { model->m_T_dt_ratio = (unsigned int)round(model->m_T_dt / model->m_dt); if (model->m_T_dt_ratio == 0) { model->m_T_dt_ratio = 1; } } // thermal step snapped to a multiple of the mechanical step
+        model->m_T_dt = model->m_T_dt_ratio * model->m_dt;
+        if (model->m_M_substeps == 0 || model->m_M_substeps > model->m_T_dt_ratio) { model->m_M_substeps = model->m_T_dt_ratio; }
         model->m_num_M_DOFs = model->m_nodes.size() * 3;
         model->m_num_T_DOFs = model->m_nodes.size() * 1;
-        model->postCreate();
+        if (!model->postCreate()) { delete model; return nullptr; }
         return model;
     }
 }
@@ -417,6 +724,9 @@ void printInfo(const Model& model)
     cout << "\tTimeStep:\t"     << model.m_dt                      << endl;
     cout << "\tTotalTime:\t"    << model.m_total_t                 << endl;
     cout << "\tNumSteps:\t"     << model.m_num_steps               << endl;
+    if (model.m_implicit_T)     { cout << "\tThermalSolver:\tImplicit (theta " << model.m_T_theta << ", TimeStep " << model.m_T_dt << ", every " << model.m_T_dt_ratio << " steps, " << model.m_M_substeps << " mechanical steps each)" << endl; }
+    if (!model.m_probe_ele_idx.empty()) { cout << "\tProbes:\t\t" << model.m_probe_ele_idx.size() << " (" << model.m_probe_format.c_str() << ", every " << model.m_probe_stride << " steps)" << endl; }
+    if (model.m_shm_every != 0) { cout << "\tSharedMemory:\t" << model.m_shm_name.c_str() << " (every " << model.m_shm_every << " steps, " << model.m_shm_slots << " slots)" << endl; }
     cout << "\n\tNode index starts at " << model.m_node_begin_index << "." << endl;
     cout << "  \tElem index starts at " << model.m_ele_begin_index  << "." << endl;
 }
@@ -425,6 +735,12 @@ ModelStates* runSimulation(const Model& model)
 {
     ModelStates* modelstates = new ModelStates(model);
     initBC(model, *modelstates);
+    ShmPublisher* publisher(nullptr);
+    if (model.m_shm_every != 0)
+    {
+        publisher = new ShmPublisher(model);
+        if (publisher->m_header == nullptr) { cerr << "\n\tWarning: cannot create shared memory " << model.m_shm_name.c_str() << ", live frames disabled." << endl; delete publisher; publisher = nullptr; }
+    }
     size_t progress(0);
     auto start_t = chrono::high_resolution_clock::now();
     cout << "\n\tusing " << NUM_THREADS << " threads" << endl;
@@ -432,10 +748,22 @@ ModelStates* runSimulation(const Model& model)
     for (size_t step = 0; step < model.m_num_steps; step++) // simulation loop
     {
         if ((float)(step + 1) / (float)model.m_num_steps * 100.f >= progress + 10) { progress += 10; cout << "\t\t\t(" << progress << "%)" << endl; }
-        computeRunTimeBC(model, *modelstates, step);
-        bool no_err = computeOneStep(model, *modelstates);
-        if (!no_err) { delete modelstates; return nullptr; }
+        // implicit thermal solver: T is advanced at the end of each thermal step (the last one may be shorter), only its last m_M_substeps mechanical steps are computed
+        const size_t T_step_begin(step / model.m_T_dt_ratio * model.m_T_dt_ratio),
+                     T_step_end  (T_step_begin + model.m_T_dt_ratio < model.m_num_steps ? T_step_begin + model.m_T_dt_ratio : model.m_num_steps);
+        const bool   is_T_step   (model.m_implicit_T && step + 1 == T_step_end);
+        bool no_err(true);
+        if (!model.m_implicit_T || step + model.m_M_substeps >= T_step_end)
+        {
+            computeRunTimeBC(model, *modelstates, step);
+            no_err = computeOneStep(model, *modelstates, !model.m_implicit_T || is_T_step);
+        }
+        if (no_err && is_T_step) { no_err = computeImplicitT(model, *modelstates, (T_step_end - T_step_begin) * model.m_dt); }
+        if (!no_err) { delete publisher; delete modelstates; return nullptr; }
+        if (!model.m_probe_ele_idx.empty() && (step + 1) % model.m_probe_stride == 0) { recordProbes(model, *modelstates, step); }
+        if (publisher != nullptr) { publisher->heartbeat(); if ((step + 1) % model.m_shm_every == 0) { publisher->publish(*modelstates, step + 1, (step + 1) * model.m_dt); } }
     }
+    delete publisher;
     auto elapsed = chrono::high_resolution_clock::now() - start_t;
     long long t = chrono::duration_cast<chrono::milliseconds>(elapsed).count();
     cout << "\n\tComputation time:\t" << t << " ms" << endl;
@@ -464,6 +792,15 @@ void initBC(const Model& model, ModelStates& modelstates)
     // BC:FixT
     for (size_t i = 0; i < model.m_fixT_idx.size(); i++) { modelstates.m_fixT_flag[model.m_fixT_idx[i]] = true; modelstates.m_fixT_mag[model.m_fixT_idx[i]] = model.m_fixT_mag[i]; }
     modelstates.m_external_Q = modelstates.m_external_Q0;
+    // BC:HeatSource
+    fill(modelstates.m_source_Q.begin(), modelstates.m_source_Q.end(), 0.f); fill(modelstates.m_source_flag.begin(), modelstates.m_source_flag.end(), false);
+    fill(modelstates.m_source_outside.begin(), modelstates.m_source_outside.end(), false); // sources outside the mesh are reported at load time
+    modelstates.m_source_nodes.clear(); modelstates.m_source_prev_nodes.clear();
+    modelstates.m_heat_sources_moved = true;
+    computeHeatSources(model, modelstates);
+    // BC:Perfu (implicit thermal solver, applied as nodal coefficients)
+    for (size_t i = 0; i < modelstates.m_perfu_coef.size(); i++) { modelstates.m_perfu_coef[i] = 0.f; modelstates.m_perfu_coefT[i] = 0.f; }
+    for (size_t i = 0; i < model.m_perfu_idx.size() && model.m_implicit_T; i++) { modelstates.m_perfu_coef[model.m_perfu_idx[i]] += model.m_perfu_const1[i]; modelstates.m_perfu_coefT[model.m_perfu_idx[i]] += model.m_perfu_const1[i] * model.m_perfu_refT[i]; }
 }
 
 void computeRunTimeBC(const Model& model, ModelStates& modelstates, const size_t curr_step)
@@ -473,11 +810,90 @@ void computeRunTimeBC(const Model& model, ModelStates& modelstates, const size_t
     for (size_t i = 0; i < model.m_disp_idx_x.size(); i++) { modelstates.m_disp_mag_t[model.m_disp_idx_x[i] * 3 + 0] = model.m_disp_mag_x[i] * n; }
     for (size_t i = 0; i < model.m_disp_idx_y.size(); i++) { modelstates.m_disp_mag_t[model.m_disp_idx_y[i] * 3 + 1] = model.m_disp_mag_y[i] * n; }
     for (size_t i = 0; i < model.m_disp_idx_z.size(); i++) { modelstates.m_disp_mag_t[model.m_disp_idx_z[i] * 3 + 2] = model.m_disp_mag_z[i] * n; }
+    // BC:HeatSource
+    const float t((curr_step + 1) * model.m_dt);
+    for (size_t i = 0; i < model.m_heat_sources.size(); i++) // input velocity, from the input position, until moveHeatSource takes over the source
+    {
+        const HeatSource& source = model.m_heat_sources[i];
+        if ((source.m_v[0] == 0.f && source.m_v[1] == 0.f && source.m_v[2] == 0.f) || modelstates.m_source_tracked[i]) { continue; }
+        HeatSource& current = modelstates.m_heat_sources[i];
+        for (size_t n = 0; n < 3; n++) { current.m_p0[n] = source.m_p0[n] + source.m_v[n] * t; current.m_p1[n] = source.m_p1[n] + source.m_v[n] * t; }
+        modelstates.m_heat_sources_moved = true;
+    }
+    if (modelstates.m_heat_sources_moved) { computeHeatSources(model, modelstates); }
     // BC:Perfu
-    for (size_t i = 0; i < model.m_perfu_idx.size(); i++) { modelstates.m_external_Q[model.m_perfu_idx[i]] = modelstates.m_external_Q0[model.m_perfu_idx[i]] - model.m_perfu_const1[i] * (modelstates.m_curr_T[model.m_perfu_idx[i]] - model.m_perfu_refT[i]); }
+    for (size_t i = 0; i < model.m_perfu_idx.size(); i++) { modelstates.m_external_Q[model.m_perfu_idx[i]] = modelstates.m_external_Q0[model.m_perfu_idx[i]] + modelstates.m_source_Q[model.m_perfu_idx[i]] - model.m_perfu_const1[i] * (modelstates.m_curr_T[model.m_perfu_idx[i]] - model.m_perfu_refT[i]); }
+}
+
+void moveHeatSource(ModelStates& modelstates, const size_t source_idx, const float p0[3], const float p1[3]) // e.g., from a tracked needle, applied at the next computeRunTimeBC, the input velocity of the source is ignored from then on
+{
+    HeatSource& source = modelstates.m_heat_sources[source_idx];
+    memcpy(source.m_p0, p0, sizeof(float) * 3);
+    memcpy(source.m_p1, source.m_type == "Point" ? p0 : p1, sizeof(float) * 3);
+    modelstates.m_source_tracked[source_idx] = true;
+    modelstates.m_heat_sources_moved = true;
+}
+
+void computeHeatSources(const Model& model, ModelStates& modelstates) // map heat sources to nodal heat, only tets near the sources are visited (TetGrid)
+{
+    for (const unsigned int n : modelstates.m_source_nodes) { modelstates.m_source_Q[n] = 0.f; modelstates.m_source_flag[n] = false; } // remove previous contributions
+    modelstates.m_source_prev_nodes.swap(modelstates.m_source_nodes); modelstates.m_source_nodes.clear();
+    for (size_t i = 0; i < modelstates.m_heat_sources.size(); i++)
+    {
+        const HeatSource& source = modelstates.m_heat_sources[i];
+        float lo[3], hi[3], sum_wVol(0.f);
+        source.getBounds(lo, hi);
+        modelstates.m_source_tets.clear(); modelstates.m_source_weights.clear();
+        model.m_grid.query(lo, hi, modelstates.m_source_tets);
+        size_t num_hits(0);
+        for (const unsigned int ele_idx : modelstates.m_source_tets) // tets whose centroids are within the source
+        {
+            const T4* tet = model.m_tets[ele_idx];
+            float centroid[3] = { 0.f, 0.f, 0.f };
+            for (size_t m = 0; m < 4; m++) { centroid[0] += model.m_nodes[tet->m_n_idx[m]]->m_x / 4.f; centroid[1] += model.m_nodes[tet->m_n_idx[m]]->m_y / 4.f; centroid[2] += model.m_nodes[tet->m_n_idx[m]]->m_z / 4.f; }
+            const float d(source.computeDistance(centroid));
+            if (d >= source.m_radius) { continue; }
+            const float wVol((1.f - d * d / (source.m_radius * source.m_radius)) * tet->m_Vol);
+            modelstates.m_source_tets[num_hits++] = ele_idx; modelstates.m_source_weights.push_back(wVol); sum_wVol += wVol;
+        }
+        if (num_hits == 0) // source thinner than the tets: deposit into the tet containing its centre
+        {
+            const float centre[3] = { (source.m_p0[0] + source.m_p1[0]) / 2.f, (source.m_p0[1] + source.m_p1[1]) / 2.f, (source.m_p0[2] + source.m_p1[2]) / 2.f };
+            float N[4];
+            const int ele_idx(model.locateTet(centre, N));
+            if (ele_idx < 0) // outside the mesh, warned once until the source is back inside
+            {
+                if (!modelstates.m_source_outside[i]) { cerr << "\n\tWarning: heat source " << i << " (" << source.m_type.c_str() << " at " << centre[0] << " " << centre[1] << " " << centre[2] << ") is outside the mesh, its power is not applied." << endl; }
+                modelstates.m_source_outside[i] = true;
+                continue;
+            }
+            for (size_t m = 0; m < 4; m++)
+            {
+                const unsigned int n(model.m_tets[ele_idx]->m_n_idx[m]);
+                if (!modelstates.m_source_flag[n]) { modelstates.m_source_flag[n] = true; modelstates.m_source_nodes.push_back(n); }
+                modelstates.m_source_Q[n] += source.m_power * N[m];
+            }
+            modelstates.m_source_outside[i] = false;
+            continue;
+        }
+        for (size_t k = 0; k < num_hits; k++)
+        {
+            const float q(source.m_power * modelstates.m_source_weights[k] / sum_wVol / 4.f);
+            for (size_t m = 0; m < 4; m++)
+            {
+                const unsigned int n(model.m_tets[modelstates.m_source_tets[k]]->m_n_idx[m]);
+                if (!modelstates.m_source_flag[n]) { modelstates.m_source_flag[n] = true; modelstates.m_source_nodes.push_back(n); }
+                modelstates.m_source_Q[n] += q;
+            }
+        }
+        modelstates.m_source_outside[i] = false;
+    }
+    for (const unsigned int n : modelstates.m_source_prev_nodes) { modelstates.m_external_Q[n] = modelstates.m_external_Q0[n] + modelstates.m_source_Q[n]; } // rebuilt rather than subtract/add, no round-off drift
+    for (const unsigned int n : modelstates.m_source_nodes)      { modelstates.m_external_Q[n] = modelstates.m_external_Q0[n] + modelstates.m_source_Q[n]; }
+    modelstates.m_heat_sources_moved = false;
 }
 
-bool computeOneStep(const Model& model, ModelStates& modelstates)
+bool computeOneStep(const Model& model, ModelStates& modelstates, const bool update_K) // update_K: compute conduction (explicit T update, or K for computeImplicitT)
 {
     bool no_err(true);
 #pragma omp parallel num_threads(NUM_THREADS)
@@ -564,6 +980,7 @@ bool computeOneStep(const Model& model, ModelStates& modelstates)
             for (size_t m = 0; m < 4; m++) { for (size_t n = 0; n < 3; n++) { modelstates.m_ele_nodal_internal_F[tet->m_idx * 12 + m * 3 + n] = f[n][m]; } }
 
             // compute DHDx and vol for the deformed state
+            if (!update_K) { continue; }
             matInv33(tet->m_X, invX, J);
             mat33Tx34(invX, tet->m_DHDX, tet->m_DHDx);
             tet->m_vol = tet->m_Vol * J;
@@ -579,6 +996,7 @@ bool computeOneStep(const Model& model, ModelStates& modelstates)
                 mat44xScalar(tet->m_K, tet->m_vol, tet->m_K);
             }
             // compute ele q
+            if (model.m_implicit_T) { continue; } // T is advanced by computeImplicitT
             for (size_t m = 0; m < 4; m++) { modelstates.m_ele_nodal_internal_Q[tet->m_idx * 4 + m] = tet->m_K[m][0] * modelstates.m_curr_T[tet->m_n_idx[0]]
                                                                                                     + tet->m_K[m][1] * modelstates.m_curr_T[tet->m_n_idx[1]]
                                                                                                     + tet->m_K[m][2] * modelstates.m_curr_T[tet->m_n_idx[2]]
@@ -615,6 +1033,7 @@ bool computeOneStep(const Model& model, ModelStates& modelstates)
                     if (isnan(modelstates.m_next_U[n_DOF])) { no_err = false; }
                 }
             }
+            if (model.m_implicit_T) { continue; }
             if (modelstates.m_fixT_flag[i] == true) { modelstates.m_next_T[i] = modelstates.m_fixT_mag[i]; } // apply BC:FixT
             else                                                                                             // explicit time integration
             {
@@ -627,11 +1046,121 @@ bool computeOneStep(const Model& model, ModelStates& modelstates)
     else
     {
         modelstates.m_prev_U.swap(modelstates.m_curr_U); modelstates.m_curr_U.swap(modelstates.m_next_U);
-        modelstates.m_curr_T.swap(modelstates.m_next_T);
+        if (!model.m_implicit_T) { modelstates.m_curr_T.swap(modelstates.m_next_T); }
     }
     return no_err;
 }
 
+bool computeImplicitT(const Model& model, ModelStates& modelstates, const float T_dt)
+{
+    // (C/dt + theta*(K+P)) dT = Q0 + Qs + P*refT - (K+P)*T_curr, T_next = T_curr + dT, solved by matrix-free Jacobi-preconditioned CG
+    // K: ele conduction (tet->m_K, from computeOneStep), C: lumped thermal mass*c, P: perfusion, Qs: heat sources, BC:FixT nodes are eliminated (zero residual and search direction)
+    // solving for the increment dT keeps the float residual meaningful when C/dt dominates
+    const float theta(model.m_T_theta), inv_dt(1.f / T_dt);
+    vector<float> &x = modelstates.m_next_T, &b = modelstates.m_cg_b, &r = modelstates.m_cg_r, &z = modelstates.m_cg_z, &p = modelstates.m_cg_p, &Ap = modelstates.m_cg_Ap, &diag = modelstates.m_cg_diag;
+    const int num_T_DOFs((int)model.m_num_T_DOFs);
+    computeThermalOperator(model, modelstates, modelstates.m_curr_T, 0.f, 1.f, b);
+#pragma omp parallel for num_threads(NUM_THREADS)
+    for (int i = 0; i < num_T_DOFs; i++)
+    {
+        float K_ii(0.f);
+        unsigned int tracking_num_eles(model.m_tracking_num_eles_i_eles_per_node_j[i * 2 + 0]),
+                     eles_per_node    (model.m_tracking_num_eles_i_eles_per_node_j[i * 2 + 1]);
+        for (unsigned int j = 0; j < eles_per_node; j++)
+        {
+            const unsigned int node_local_idx(model.m_ele_node_local_idx_pair[(tracking_num_eles + j) * 2 + 1]);
+            K_ii += model.m_tets[model.m_ele_node_local_idx_pair[(tracking_num_eles + j) * 2 + 0]]->m_K[node_local_idx][node_local_idx];
+        }
+        diag[i] = modelstates.m_T_capacity[i] * inv_dt + theta * (K_ii + modelstates.m_perfu_coef[i]);
+        b[i] = modelstates.m_external_Q0[i] + modelstates.m_source_Q[i] + modelstates.m_perfu_coefT[i] - b[i];
+        x[i] = modelstates.m_fixT_flag[i] ? modelstates.m_fixT_mag[i] - modelstates.m_curr_T[i] : 0.f; // initial guess, apply BC:FixT
+    }
+    computeThermalOperator(model, modelstates, x, inv_dt, theta, Ap);
+#pragma omp parallel for num_threads(NUM_THREADS)
+    for (int i = 0; i < num_T_DOFs; i++)
+    {
+        r[i] = modelstates.m_fixT_flag[i] ? 0.f : b[i] - Ap[i];
+        z[i] = r[i] / diag[i];
+        p[i] = z[i];
+        if (modelstates.m_fixT_flag[i]) { b[i] = 0.f; } // for the norm of the free DOFs
+    }
+    const double tol_sq((double)CG_TOL * CG_TOL * dotProduct(b, b));
+    double rz(dotProduct(r, z)), rr(dotProduct(r, r));
+    int iter(0);
+    for (; iter < CG_MAX_ITERS && rr > tol_sq; iter++)
+    {
+        computeThermalOperator(model, modelstates, p, inv_dt, theta, Ap);
+#pragma omp parallel for num_threads(NUM_THREADS)
+        for (int i = 0; i < num_T_DOFs; i++) { if (modelstates.m_fixT_flag[i]) { Ap[i] = 0.f; } }
+        const float alpha((float)(rz / dotProduct(p, Ap)));
+#pragma omp parallel for num_threads(NUM_THREADS)
+        for (int i = 0; i < num_T_DOFs; i++) { x[i] += alpha * p[i]; r[i] -= alpha * Ap[i]; z[i] = r[i] / diag[i]; }
+        const double rz_new(dotProduct(r, z));
+        const float beta((float)(rz_new / rz));
+        rz = rz_new; rr = dotProduct(r, r);
+#pragma omp parallel for num_threads(NUM_THREADS)
+        for (int i = 0; i < num_T_DOFs; i++) { p[i] = z[i] + beta * p[i]; }
+    }
+    if (isnan(rr)) { cerr << "\n\tError: implicit thermal solver diverged, simulation aborted." << endl; return false; }
+    if (rr > tol_sq) { cerr << "\n\tWarning: implicit thermal solver not converged in " << CG_MAX_ITERS << " iterations (relative residual " << sqrt(rr * CG_TOL * CG_TOL / tol_sq) << ")." << endl; }
+#pragma omp parallel for num_threads(NUM_THREADS)
+    for (int i = 0; i < num_T_DOFs; i++) { x[i] += modelstates.m_curr_T[i]; }
+    modelstates.m_curr_T.swap(modelstates.m_next_T);
+    return true;
+}
+
+void computeThermalOperator(const Model& model, ModelStates& modelstates, const vector<float>& x, const float a_inv_dt, const float b, vector<float>& y) // y = a_inv_dt*C*x + b*(K+P)*x
+{
+    const int num_tets((int)model.m_tets.size()), num_nodes((int)model.m_nodes.size());
+#pragma omp parallel num_threads(NUM_THREADS)
+    {
+        int id = omp_get_thread_num();
+        for (int i = id; i < num_tets; i += NUM_THREADS) // loop through tets to compute ele K*x
+        {
+            T4 *tet = model.m_tets[i];
+            for (size_t m = 0; m < 4; m++) { modelstates.m_ele_nodal_internal_Q[tet->m_idx * 4 + m] = tet->m_K[m][0] * x[tet->m_n_idx[0]]
+                                                                                                    + tet->m_K[m][1] * x[tet->m_n_idx[1]]
+                                                                                                    + tet->m_K[m][2] * x[tet->m_n_idx[2]]
+                                                                                                    + tet->m_K[m][3] * x[tet->m_n_idx[3]]; }
+        }
+#pragma omp barrier
+        for (int i = id; i < num_nodes; i += NUM_THREADS) // loop through nodes to assemble K*x
+        {
+            float nodal_Kx(0.f);
+            unsigned int tracking_num_eles(model.m_tracking_num_eles_i_eles_per_node_j[i * 2 + 0]),
+                         eles_per_node    (model.m_tracking_num_eles_i_eles_per_node_j[i * 2 + 1]);
+            for (unsigned int j = 0; j < eles_per_node; j++) { nodal_Kx += modelstates.m_ele_nodal_internal_Q[model.m_ele_node_local_idx_pair[(tracking_num_eles + j) * 2 + 0] * 4 + model.m_ele_node_local_idx_pair[(tracking_num_eles + j) * 2 + 1]]; }
+            y[i] = a_inv_dt * modelstates.m_T_capacity[i] * x[i] + b * (nodal_Kx + modelstates.m_perfu_coef[i] * x[i]);
+        }
+    }
+}
+
+double dotProduct(const vector<float>& x, const vector<float>& y)
+{
+    double sum(0.0);
+    const int n((int)x.size());
+#pragma omp parallel for reduction(+:sum) num_threads(NUM_THREADS)
+    for (int i = 0; i < n; i++) { sum += (double)x[i] * y[i]; }
+    return sum;
+}
+
+void recordProbes(const Model& model, ModelStates& modelstates, const size_t curr_step)
+{
+    modelstates.m_probe_hist.push_back((curr_step + 1) * model.m_dt);
+    for (size_t i = 0; i < model.m_probe_ele_idx.size(); i++)
+    {
+        const T4* tet = model.m_tets[model.m_probe_ele_idx[i]];
+        const float* N = &model.m_probe_N[i * 4];
+        float T(0.f), U[3] = { 0.f, 0.f, 0.f };
+        for (size_t m = 0; m < 4; m++)
+        {
+            T += N[m] * modelstates.m_curr_T[tet->m_n_idx[m]];
+            for (size_t n = 0; n < 3; n++) { U[n] += N[m] * modelstates.m_curr_U[tet->m_n_idx[m] * 3 + n]; }
+        }
+        modelstates.m_probe_hist.push_back(T); modelstates.m_probe_hist.push_back(U[0]); modelstates.m_probe_hist.push_back(U[1]); modelstates.m_probe_hist.push_back(U[2]);
+    }
+}
+
 int exportVTK(const Model& model, const ModelStates& modelstates)
 {
     const vector<string> outputs{ "U.vtk", "Undeformed.vtk", "T.vtk" }; // other outputs can be added by the user, e.g., S.vtk where 2nd PK stresses are stored in tet->m_S
@@ -672,6 +1201,36 @@ int exportVTK(const Model& model, const ModelStates& modelstates)
     return EXIT_SUCCESS;
 }
 
+int exportProbes(const Model& model, const ModelStates& modelstates)
+{
+    const size_t num_probes(model.m_probe_ele_idx.size()), record_size(1 + num_probes * 4), num_records(modelstates.m_probe_hist.size() / record_size);
+    if (model.m_probe_format == "Binary") // header: uint32 num_probes, uint32 num_records; then num_records records of float t, (T, Ux, Uy, Uz) per probe
+    {
+        const string fname("Probes.bin");
+        ofstream fout(fname.c_str(), ios::binary);
+        if (!fout.is_open()) { cerr << "\n\tError: cannot open " << fname.c_str() << " for writing, results not saved." << endl; return EXIT_FAILURE; }
+        const unsigned int header[2] = { (unsigned int)num_probes, (unsigned int)num_records };
+        fout.write((const char*)header, sizeof(header));
+        fout.write((const char*)modelstates.m_probe_hist.data(), sizeof(float) * num_records * record_size);
+        cout << "\t\t\t" << fname.c_str() << endl;
+    }
+    else
+    {
+        const string fname("Probes.csv");
+        ofstream fout(fname.c_str());
+        if (!fout.is_open()) { cerr << "\n\tError: cannot open " << fname.c_str() << " for writing, results not saved." << endl; return EXIT_FAILURE; }
+        fout << "t"; for (size_t i = 0; i < num_probes; i++) { fout << ",P" << i << "_T,P" << i << "_Ux,P" << i << "_Uy,P" << i << "_Uz"; } fout << endl;
+        const float* record = modelstates.m_probe_hist.data();
+        for (size_t k = 0; k < num_records; k++, record += record_size)
+        {
+            fout << record[0]; for (size_t j = 1; j < record_size; j++) { fout << "," << record[j]; } fout << "\n";
+        }
+        cout << "\t\t\t" << fname.c_str() << endl;
+    }
+    cout << "\tProbes saved." << endl;
+    return EXIT_SUCCESS;
+}
+
 void mat33x33(const float A[3][3], const float B[3][3], float AB[3][3])
 {
     memset(AB, 0, sizeof(float) * 3 * 3);
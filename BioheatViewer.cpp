@@ -0,0 +1,140 @@
+/*
+MIT License
+
+Copyright (c) 2021 Jinao Zhang
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+// reference consumer of the live T/U frames published by BioheatExpan (SharedMemory option), reports frame throughput and latency
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include "SharedFrames.h"
+using namespace std;
+
+// methods
+bool attachWriter(const char* name, const uint64_t prev_session, ShmMapping& mapping);
+bool followWriter(ShmHeader* header);
+bool readFrame   (ShmHeader* header, const uint64_t frame, vector<float>& T, vector<float>& U, vector<float>& T_buf, vector<float>& U_buf, ShmSlotHeader& info);
+void printReport (const uint64_t frames, const uint64_t dropped, const uint64_t bytes, const double latency_sum_ms, const double latency_max_ms, const double seconds, const ShmSlotHeader& info, const vector<float>& T);
+
+int main(int argc, char **argv)
+{
+    if (argc - 1 == 0) { cerr << "\n\tError: missing input argument (shared memory name, e.g., BioheatFrames)." << endl; return EXIT_FAILURE; }
+    ShmMapping mapping;
+    uint64_t session(0);
+    while (attachWriter(argv[1], session, mapping)) // one solver run per iteration
+    {
+        ShmHeader* header = (ShmHeader*)mapping.m_ptr;
+        session = header->m_session_id;
+        cout << "\n\tAttached:\t" << argv[1] << " (session " << hex << session << dec << ", " << header->m_num_nodes << " nodes, " << header->m_num_slots << " slots, every " << header->m_every << " steps)" << endl;
+        const bool finished(followWriter(header));
+        shmRelease(mapping);
+        if (finished) { return EXIT_SUCCESS; }
+        cerr << "\n\tWarning: solver stopped without finishing (crashed, killed or hung), waiting for a new run of " << argv[1] << endl;
+    }
+    cerr << "\n\tError: cannot attach to shared memory: " << argv[1] << " (no running solver)." << endl;
+    return EXIT_FAILURE;
+}
+
+bool attachWriter(const char* name, const uint64_t prev_session, ShmMapping& mapping) // waits up to 30 s for a running solver, segments of dead solvers and of prev_session are skipped
+{
+    const auto wait_t = chrono::steady_clock::now();
+    while (chrono::steady_clock::now() - wait_t < chrono::seconds(30))
+    {
+        if (shmAttach(name, mapping))
+        {
+            const ShmHeader* header = (const ShmHeader*)mapping.m_ptr;
+            if (header->m_session_id != prev_session && (header->m_done.load(memory_order_acquire) != 0 || shmWriterAlive(header))) { return true; }
+            shmRelease(mapping);
+        }
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    return false;
+}
+
+bool followWriter(ShmHeader* header) // reads frames until the solver is done (true) or gone (false)
+{
+    vector<float> T(header->m_num_nodes, 0.f), U(header->m_num_nodes * 3, 0.f), T_buf(T.size(), 0.f), U_buf(U.size(), 0.f);
+    ShmSlotHeader info; info.m_step = 0; info.m_t = 0.f; info.m_publish_ns = 0;
+    uint64_t next(header->m_write_seq.load(memory_order_acquire)), frames(0), dropped(0), bytes(0), total_frames(0), total_dropped(0);
+    double latency_sum_ms(0.0), latency_max_ms(0.0), total_latency_sum_ms(0.0), total_latency_max_ms(0.0);
+    auto report_t = chrono::steady_clock::now(), start_t = report_t, alive_t = report_t;
+    bool finished(false);
+    while (true)
+    {
+        const bool     done    (header->m_done.load(memory_order_acquire) != 0);
+        const uint64_t complete(header->m_write_seq.load(memory_order_acquire));
+        if (complete - next > header->m_num_slots) { dropped += complete - header->m_num_slots - next; next = complete - header->m_num_slots; } // lapped by the solver
+        while (next < complete)
+        {
+            if (readFrame(header, next, T, U, T_buf, U_buf, info))
+            {
+                const double latency_ms = (shmNowNs() - info.m_publish_ns) / 1e6;
+                latency_sum_ms += latency_ms; if (latency_ms > latency_max_ms) { latency_max_ms = latency_ms; }
+                frames++; bytes += sizeof(float) * (T.size() + U.size());
+            }
+            else { dropped++; } // overwritten while being read
+            next++;
+        }
+        const double seconds = chrono::duration<double>(chrono::steady_clock::now() - report_t).count();
+        if (seconds >= 1.0 || (done && frames != 0))
+        {
+            printReport(frames, dropped, bytes, latency_sum_ms, latency_max_ms, seconds, info, T);
+            total_frames += frames; total_dropped += dropped; total_latency_sum_ms += latency_sum_ms; if (latency_max_ms > total_latency_max_ms) { total_latency_max_ms = latency_max_ms; }
+            frames = 0; dropped = 0; bytes = 0; latency_sum_ms = 0.0; latency_max_ms = 0.0; report_t = chrono::steady_clock::now();
+        }
+        if (done) { finished = true; break; }
+        if (chrono::steady_clock::now() - alive_t >= chrono::milliseconds(100)) // m_done is re-read since a solver that just finished is no longer alive
+        {
+            if (!shmWriterAlive(header) && header->m_done.load(memory_order_acquire) == 0) { break; }
+            alive_t = chrono::steady_clock::now();
+        }
+        this_thread::sleep_for(chrono::microseconds(200));
+    }
+    total_frames += frames; total_dropped += dropped; total_latency_sum_ms += latency_sum_ms; if (latency_max_ms > total_latency_max_ms) { total_latency_max_ms = latency_max_ms; } // not yet reported
+    cout << "\n\tFrames:\t\t" << total_frames << " received, " << total_dropped << " dropped in " << chrono::duration<double>(chrono::steady_clock::now() - start_t).count() << " s" << endl;
+    cout << "\tLatency:\t" << (total_frames != 0 ? total_latency_sum_ms / total_frames : 0.0) << " ms mean, " << total_latency_max_ms << " ms max" << endl;
+    return finished;
+}
+
+bool readFrame(ShmHeader* header, const uint64_t frame, vector<float>& T, vector<float>& U, vector<float>& T_buf, vector<float>& U_buf, ShmSlotHeader& info) // T, U and info are only updated by valid frames
+{
+    ShmSlotHeader* slot = shmSlot(header, frame);
+    const uint64_t seq1 = slot->m_seq.load(memory_order_acquire);
+    if (seq1 != frame * 2 + 2) { return false; } // being written or already overwritten by a newer frame
+    memcpy(T_buf.data(), shmSlotT(slot),                      sizeof(float) * T_buf.size());
+    memcpy(U_buf.data(), shmSlotU(slot, header->m_num_nodes), sizeof(float) * U_buf.size());
+    const uint64_t step(slot->m_step); const float t(slot->m_t); const int64_t publish_ns(slot->m_publish_ns);
+    atomic_thread_fence(memory_order_acquire);
+    if (slot->m_seq.load(memory_order_relaxed) != seq1) { return false; }
+    T.swap(T_buf); U.swap(U_buf);
+    info.m_step = step; info.m_t = t; info.m_publish_ns = publish_ns;
+    return true;
+}
+void printReport(const uint64_t frames, const uint64_t dropped, const uint64_t bytes, const double latency_sum_ms, const double latency_max_ms, const double seconds, const ShmSlotHeader& info, const vector<float>& T)
+{
+    float T_min(T.empty() ? 0.f : T[0]), T_max(T_min);
+    for (const float val : T) { if (val < T_min) { T_min = val; } if (val > T_max) { T_max = val; } }
+    cout << "\tstep " << info.m_step << " (t = " << info.m_t << " s):"
+         << "\tT [" << T_min << ", " << T_max << "]"
+         << "\t" << frames / seconds << " frames/s (" << bytes / seconds / 1e6 << " MB/s, " << dropped << " dropped)"
+         << "\tlatency " << (frames != 0 ? latency_sum_ms / frames : 0.0) << " ms mean, " << latency_max_ms << " ms max" << endl;
+}
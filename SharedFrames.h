@@ -0,0 +1,194 @@
+/*
+MIT License
+
+Copyright (c) 2021 Jinao Zhang
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+// shared-memory ring buffer of T/U frames, shared by the solver (BioheatExpan.cpp, writer) and viewers (e.g., BioheatViewer.cpp, readers)
+// layout: [ShmHeader][slot 0]...[slot num_slots-1], slot: [ShmSlotHeader][float T[num_nodes]][float U[num_nodes*3]], all 64-byte aligned
+// protocol: the writer never waits. frame k goes to slot k % num_slots, guarded by a per-slot sequence counter (seqlock):
+//           m_seq = 2k+1 while writing, 2k+2 when complete; m_write_seq = k+1 once frame k is complete.
+//           a reader copies the slot out and accepts it only if m_seq == 2k+2 both before and after the copy.
+// liveness: each run has its own m_session_id, and the writer stamps m_heartbeat_ns every step. a segment left by a crashed or killed writer
+//           (m_done == 0, but its process is gone or its heartbeat is older than SHM_STALE_NS) must not be followed, see shmWriterAlive.
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <new>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <cerrno>
+#endif
+
+static const uint32_t SHM_MAGIC(0x48424653), SHM_VERSION(2); // "SFBH"
+static const int64_t  SHM_STALE_NS(5000000000);              // writer considered gone if its heartbeat is older than this (5 s)
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared-memory frames need lock-free 64-bit atomics");
+static_assert(std::atomic<int64_t>::is_always_lock_free,  "shared-memory frames need lock-free 64-bit atomics");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared-memory frames need lock-free 32-bit atomics");
+
+struct ShmHeader
+{
+    uint32_t              m_magic, m_version;
+    uint32_t              m_num_nodes, m_num_slots, m_every;   // every: solver steps between frames
+    float                 m_dt;                                // solver time step
+    uint64_t              m_header_bytes, m_slot_bytes;
+    uint64_t              m_session_id;                        // run identity, differs for every solver run
+    uint32_t              m_writer_pid;                        // process id of the solver
+    std::atomic<int64_t>  m_heartbeat_ns;                      // steady_clock time stamp (ns) of the solver's latest step
+    std::atomic<uint64_t> m_write_seq;                         // number of complete frames, latest frame is m_write_seq-1
+    std::atomic<uint32_t> m_done;                              // 1 once the solver has published its last frame
+};
+
+struct ShmSlotHeader
+{
+    std::atomic<uint64_t> m_seq;
+    uint64_t              m_step;
+    int64_t               m_publish_ns;                        // steady_clock time stamp (ns) when the frame was written, for latency measurement
+    float                 m_t;
+};
+
+inline int64_t  shmNowNs     ()                               { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+inline uint64_t shmAlign64   (const uint64_t bytes)            { return (bytes + 63) / 64 * 64; }
+inline uint64_t shmHeaderBytes()                               { return shmAlign64(sizeof(ShmHeader)); }
+inline uint64_t shmSlotBytes (const uint32_t num_nodes)        { return shmAlign64(sizeof(ShmSlotHeader) + sizeof(float) * num_nodes * 4); }
+inline float*   shmSlotT     (ShmSlotHeader* slot)             { return (float*)((char*)slot + shmAlign64(sizeof(ShmSlotHeader))); }
+inline float*   shmSlotU     (ShmSlotHeader* slot, const uint32_t num_nodes) { return shmSlotT(slot) + num_nodes; }
+inline ShmSlotHeader* shmSlot(ShmHeader* header, const uint64_t frame) { return (ShmSlotHeader*)((char*)header + header->m_header_bytes + (frame % header->m_num_slots) * header->m_slot_bytes); }
+
+// platform mapping of a named shared-memory object (POSIX shm_open/mmap, or Windows file mapping)
+struct ShmMapping
+{
+    std::string m_name;
+    void*       m_ptr;
+    uint64_t    m_bytes;
+    bool        m_owner;
+#ifdef _WIN32
+    HANDLE      m_handle;
+    ShmMapping() : m_name(""), m_ptr(nullptr), m_bytes(0), m_owner(false), m_handle(NULL) {};
+#else
+    ShmMapping() : m_name(""), m_ptr(nullptr), m_bytes(0), m_owner(false) {};
+#endif
+};
+
+inline uint32_t shmProcessId()
+{
+#ifdef _WIN32
+    return (uint32_t)GetCurrentProcessId();
+#else
+    return (uint32_t)getpid();
+#endif
+}
+
+inline bool shmProcessAlive(const uint32_t pid)
+{
+#ifdef _WIN32
+    HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, (DWORD)pid);
+    if (process == NULL) { return GetLastError() == ERROR_ACCESS_DENIED; } // exists but owned by another user
+    const bool alive(WaitForSingleObject(process, 0) == WAIT_TIMEOUT); CloseHandle(process);
+    return alive;
+#else
+    return kill((pid_t)pid, 0) == 0 || errno == EPERM;
+#endif
+}
+
+inline bool shmWriterAlive(const ShmHeader* header) // false once the writer process is gone or has stopped stepping (hung, or its pid reused)
+{
+    if (!shmProcessAlive(header->m_writer_pid)) { return false; }
+    return shmNowNs() - header->m_heartbeat_ns.load(std::memory_order_acquire) < SHM_STALE_NS;
+}
+
+inline std::string shmPlatformName(const std::string& name)
+{
+#ifdef _WIN32
+    return "Local\\" + name;
+#else
+    return "/" + name;
+#endif
+}
+
+inline bool shmCreate(const std::string& name, const uint64_t bytes, ShmMapping& mapping)
+{
+    mapping.m_name = shmPlatformName(name); mapping.m_bytes = bytes; mapping.m_owner = true;
+#ifdef _WIN32
+    mapping.m_handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)(bytes >> 32), (DWORD)(bytes & 0xFFFFFFFF), mapping.m_name.c_str());
+    if (mapping.m_handle == NULL) { return false; }
+    mapping.m_ptr = MapViewOfFile(mapping.m_handle, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+    if (mapping.m_ptr == nullptr) { CloseHandle(mapping.m_handle); mapping.m_handle = NULL; return false; }
+#else
+    shm_unlink(mapping.m_name.c_str()); // remove a stale object left by an aborted run
+    int fd = shm_open(mapping.m_name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0) { return false; }
+    if (ftruncate(fd, (off_t)bytes) != 0) { close(fd); shm_unlink(mapping.m_name.c_str()); return false; }
+    void* ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0); close(fd);
+    if (ptr == MAP_FAILED) { shm_unlink(mapping.m_name.c_str()); return false; }
+    mapping.m_ptr = ptr;
+#endif
+    memset(mapping.m_ptr, 0, bytes);
+    return true;
+}
+
+inline void shmRelease(ShmMapping& mapping)
+{
+    if (mapping.m_ptr == nullptr) { return; }
+#ifdef _WIN32
+    UnmapViewOfFile(mapping.m_ptr); CloseHandle(mapping.m_handle); mapping.m_handle = NULL;
+#else
+    munmap(mapping.m_ptr, mapping.m_bytes);
+    if (mapping.m_owner) { shm_unlink(mapping.m_name.c_str()); } // readers that are attached keep their mapping
+#endif
+    mapping.m_ptr = nullptr;
+}
+
+inline bool shmAttach(const std::string& name, ShmMapping& mapping) // read-only, size taken from the header
+{
+    mapping.m_name = shmPlatformName(name); mapping.m_owner = false;
+#ifdef _WIN32
+    mapping.m_handle = OpenFileMappingA(FILE_MAP_READ, FALSE, mapping.m_name.c_str());
+    if (mapping.m_handle == NULL) { return false; }
+    mapping.m_ptr = MapViewOfFile(mapping.m_handle, FILE_MAP_READ, 0, 0, 0);
+    if (mapping.m_ptr == nullptr) { CloseHandle(mapping.m_handle); mapping.m_handle = NULL; return false; }
+    MEMORY_BASIC_INFORMATION info; VirtualQuery(mapping.m_ptr, &info, sizeof(info)); mapping.m_bytes = info.RegionSize;
+#else
+    int fd = shm_open(mapping.m_name.c_str(), O_RDONLY, 0);
+    if (fd < 0) { return false; }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(ShmHeader)) { close(fd); return false; }
+    void* ptr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0); close(fd);
+    if (ptr == MAP_FAILED) { return false; }
+    mapping.m_ptr = ptr; mapping.m_bytes = (uint64_t)st.st_size;
+#endif
+    const ShmHeader* header = (const ShmHeader*)mapping.m_ptr;
+    if (header->m_magic != SHM_MAGIC || header->m_version != SHM_VERSION) { shmRelease(mapping); return false; } // not (yet) initialised by the solver, m_magic is written last
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header->m_header_bytes + (uint64_t)header->m_num_slots * header->m_slot_bytes > mapping.m_bytes) { shmRelease(mapping); return false; }
+    return true;
+}